@@ -1,9 +1,7 @@
 
-#include <iostream>
 #include <stdio.h>
 #include <string>
 #include <fstream>
-#include <sstream>
 #include <algorithm>
 #include <functional>
 #include <vector>
@@ -18,40 +16,33 @@
 #include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/Basic/Diagnostic.h"
 #include "clang/AST/DeclObjC.h"
+#include "clang/Basic/TargetInfo.h"
 #include "clang/Sema/Sema.h"
+#include "../FYPluginSupport.h"
 using namespace clang;
 using namespace std;
 using namespace llvm;
 using namespace clang::ast_matchers;
+using namespace FYPluginSupport;
 
 namespace CodeCheckPlugin {
 
-    static vector<string> split(const string &s, char delim){
-        vector<string> elems;
-        stringstream ss;
-        ss.str(s);
-        string item;
-        while (getline(ss, item, delim)) {
-            elems.push_back(item);
-        }
-        return elems;
-    }
-    
     // MARK: - my handler
     class CodeCheckHandler : public MatchFinder::MatchCallback {
     private:
         CompilerInstance &ci;
+        FYBaseline &baseline;
         
     public:
-        CodeCheckHandler(CompilerInstance &ci) :ci(ci) {}
+        CodeCheckHandler(CompilerInstance &ci, FYBaseline &baseline)
+        :ci(ci), baseline(baseline) {}
         //检查类名的规范
         void checkInterfaceDecl(const ObjCInterfaceDecl *decl){
             //获取类名
             StringRef className = decl->getName();
             char c = className[0];
-            if (isLowercase(c)) {
+            if (isLowercase(c) && baseline.shouldReport("class-lowercase", decl, className)) {
                 std::string tempName = className;
-                cout << tempName << endl;
                 tempName[0] = toUppercase(c);
                 StringRef replacement(tempName);
                 SourceLocation nameStart = decl->getLocation();
@@ -66,7 +57,7 @@ namespace CodeCheckPlugin {
             }
             //查找下划线位置
             size_t pos = decl->getName().find('_');
-            if (pos != StringRef::npos) {
+            if (pos != StringRef::npos && baseline.shouldReport("class-underscore", decl, className)) {
                 DiagnosticsEngine &D = ci.getDiagnostics();
                 SourceLocation loc = decl->getLocation().getLocWithOffset(pos);
                 
@@ -89,8 +80,8 @@ namespace CodeCheckPlugin {
                 ObjCPropertyDecl::PropertyAttributeKind attrKind = propertyDecl->getPropertyAttributes();
                 string typeStr = propertyDecl->getType().getAsString();
                 
-                if (propertyDecl->getTypeSourceInfo() && isShouldUseCopy(typeStr) && !(attrKind & ObjCPropertyDecl::OBJC_PR_copy)) {
-                    cout<<"--------- "<<typeStr<<": 不是使用的 copy 修饰--------"<<endl;
+                if (propertyDecl->getTypeSourceInfo() && isShouldUseCopy(typeStr) && !(attrKind & ObjCPropertyDecl::OBJC_PR_copy) &&
+                    baseline.shouldReport("property-copy", propertyDecl, propertyDecl->getName())) {
                     DiagnosticsEngine &diag = ci.getDiagnostics();
                     diag.Report(propertyDecl->getBeginLoc(), diag.getCustomDiagID(DiagnosticsEngine::Warning, "--------- %0 不是使用的 copy 修饰--------")) << typeStr;
                 }
@@ -111,7 +102,7 @@ namespace CodeCheckPlugin {
             }
             //名称必须以小写字母开头
             char c = name[checkUppercaseNameIndex];
-            if (isUppercase(c))
+            if (isUppercase(c) && baseline.shouldReport("property-uppercase", decl, name))
             {
                 //修正提示
                 std::string tempName = name;
@@ -141,7 +132,7 @@ namespace CodeCheckPlugin {
             
             //类名不能包含下划线
             size_t underscorePos = name.find('_', 1);
-            if (underscorePos != StringRef::npos)
+            if (underscorePos != StringRef::npos && baseline.shouldReport("property-underscore", decl, name))
             {
                 //修正提示
                 std::string tempName = name;
@@ -170,7 +161,7 @@ namespace CodeCheckPlugin {
             {
                 ObjCPropertyDecl::PropertyAttributeKind attrKind = decl -> getPropertyAttributes();
                 
-                if(!(attrKind & ObjCPropertyDecl::OBJC_PR_weak))
+                if(!(attrKind & ObjCPropertyDecl::OBJC_PR_weak) && baseline.shouldReport("delegate-weak", decl, decl -> getName()))
                 {
                     diagWaringReport(decl -> getLocation(), "代理属性应该使用weak修饰", NULL);
                 }
@@ -190,7 +181,7 @@ namespace CodeCheckPlugin {
             {
                 StringRef selName = sel.getNameForSlot(i);
                 char c = selName[0];
-                if (isUppercase(c))
+                if (isUppercase(c) && baseline.shouldReport("method-uppercase", decl, selName))
                 {
                     //修正提示
                     std::string tempName = selName;
@@ -215,11 +206,13 @@ namespace CodeCheckPlugin {
                 //存在方法体
                 Stmt *methodBody = decl -> getBody();
                 
-                string srcCode;
-                srcCode.assign(ci.getSourceManager().getCharacterData(methodBody->getSourceRange().getBegin()),
-                               methodBody->getSourceRange().getEnd().getRawEncoding() - methodBody->getSourceRange().getBegin().getRawEncoding() + 1);
-                vector<string> lines = split(srcCode, '\n');
-                if(lines.size() > 50){
+                //按展开位置的行号计算行数，方法体首尾位于宏展开中时也不会越界
+                SourceManager &SM = ci.getSourceManager();
+                unsigned beginLine = SM.getExpansionLineNumber(methodBody->getBeginLoc());
+                unsigned endLine = SM.getExpansionLineNumber(methodBody->getEndLoc());
+                //首尾不在同一文件时行号可能倒序，避免无符号数下溢
+                unsigned lineCount = endLine >= beginLine ? endLine - beginLine + 1 : 0;
+                if(lineCount > 50 && baseline.shouldReport("method-lines", decl, decl -> getSelector().getAsString())){
                     diagWaringReport(decl -> getSourceRange().getBegin(), "单个方法内行数不能超过50行", NULL);
                 }
             }
@@ -286,11 +279,20 @@ namespace CodeCheckPlugin {
     //用于读取AST的抽象基类
     class CodeCheckConsumer: public ASTConsumer {
     private:
+        //成员按声明顺序构造，baseline 依赖 arena，handler 依赖 baseline，必须依次放置
+        CompilerInstance &ci;
+        string fileName;
+        bool memReport;
+        FYScratchArena arena;
+        FYBaseline baseline;
         MatchFinder matcher;
         CodeCheckHandler handler;
     public:
         //FYASTConsumer构造方法
-        CodeCheckConsumer(CompilerInstance &ci) :handler(ci) {
+        CodeCheckConsumer(CompilerInstance &ci, StringRef fileName, bool memReport, const FYBaselineOptions &baselineOptions)
+        :ci(ci), fileName(fileName), memReport(memReport), baseline(arena, "CodeCheckPlugin"), handler(ci, baseline) {
+            baseline.loadAndReport(ci.getDiagnostics(), baselineOptions, ci.getTarget().getTriple().str());
+
             //添加需要查找的语法树的节点，绑定标识，找到后的回调 handler 的run方法
             matcher.addMatcher(objcInterfaceDecl().bind("ObjCInterfaceDecl"), &handler);
             matcher.addMatcher(objcMethodDecl().bind("ObjCMethodDecl"), &handler);
@@ -303,19 +305,44 @@ namespace CodeCheckPlugin {
         void HandleTranslationUnit(ASTContext &context) {
             //matcher查找语法树的节点
             matcher.matchAST(context);
+            
+            baseline.saveAndReport(ci.getDiagnostics(), fileName);
+            
+            if (memReport) {
+                arena.noteHeapBytes("baseline", baseline.getHeapBytes());
+                arena.report(llvm::errs(), "CodeCheckPlugin", fileName);
+            }
+            //编译单元结束，释放本单元的临时内存，arena 上的数组一并丢弃
+            baseline.releaseScratch();
+            arena.reset();
         }
     };
     /**重写CreateASTConsumer方法
      创建并返回给前端一个ASTConsumer
      */
     class CodeCheckAction: public PluginASTAction {
+    private:
+        //-plugin-arg-CodeCheckPlugin -mem-report 时输出每个编译单元的内存统计
+        bool memReport = false;
+        //baseline=PATH、baseline-update、baseline-merge，见 FYBaselineOptions
+        FYBaselineOptions baselineOptions;
+        
     public:
         unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &ci, StringRef iFile) {
-            return unique_ptr<CodeCheckConsumer> (new CodeCheckConsumer(ci));
+            return unique_ptr<CodeCheckConsumer> (new CodeCheckConsumer(ci, iFile, memReport, baselineOptions));
         }
         
         bool ParseArgs(const CompilerInstance &ci, const std::vector<std::string> &args) {
-            return true;
+            for (const string &arg : args)
+            {
+                StringRef argRef(arg);
+                if (argRef == "-mem-report" || argRef == "mem-report")
+                    memReport = true;
+                else
+                    baselineOptions.consumeArg(argRef);
+            }
+            
+            return baselineOptions.validate(ci.getDiagnostics());
         }
     };
 }
@@ -1,7 +1,6 @@
 
-#include <iostream>
 #include <vector>
-#include <sstream>
+#include <algorithm>
 #include <string>
 #include "clang/AST/AST.h"
 #include "clang/AST/ASTConsumer.h"
@@ -14,11 +13,17 @@
 #include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/Basic/Diagnostic.h"
 #include "clang/AST/DeclObjC.h"
+#include "clang/Lex/Lexer.h"
+#include "clang/Lex/PPCallbacks.h"
+#include "clang/Lex/Preprocessor.h"
+#include "clang/Basic/TargetInfo.h"
+#include "../FYPluginSupport.h"
 
 using namespace clang;
 using namespace std;
 using namespace llvm;
 using namespace clang::ast_matchers;
+using namespace FYPluginSupport;
 /**
  RecursiveASTVisitor这是Clang用来以深度优先的方式遍历AST以及访问所有节点的工具类，
  支持前序遍历和后序遍历。它使用的是访问者模式。这个类依次做了3件事：
@@ -27,24 +32,203 @@ using namespace clang::ast_matchers;
  访问（Visit）：对于每一个节点，如果用户重写了VisitXXX方法，则调用这个重写的Visit实现，否则使用基类默认的实现。
  
  */
-static vector<string> split(const string &s, char delim){
-    vector<string> elems;
-    stringstream ss;
-    ss.str(s);
-    string item;
-    while (getline(ss, item, delim)) {
-        elems.push_back(item);
-    }
-    return elems;
-}
-
 namespace  {
 
+    /**
+     记录解析过程中 DEBUG 条件编译分支所覆盖的源码区间
+     
+     Release 下这些分支会被预处理器跳过，Debug 下则会进入 AST，
+     日志检测需要据此排除已经被 #if DEBUG 包裹的调用
+     */
+    class FYDebugRegions {
+    private:
+        vector<SourceRange> ranges;
+        
+    public:
+        void addRange(SourceLocation begin, SourceLocation end){
+            ranges.push_back(SourceRange(begin, end));
+        }
+        
+        bool contains(const SourceManager &SM, SourceLocation loc) const {
+            SourceLocation fileLoc = SM.getExpansionLoc(loc);
+            for (const SourceRange &range : ranges)
+            {
+                if (!SM.isBeforeInTranslationUnit(fileLoc, range.getBegin()) &&
+                    SM.isBeforeInTranslationUnit(fileLoc, range.getEnd()))
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+    
+    //条件编译分支相对 DEBUG 的含义
+    enum FYDebugSense {
+        FYDebugSenseNone,
+        FYDebugSenseDebug,
+        FYDebugSenseRelease
+    };
+    
+    /**
+     预处理回调，跟踪 #if/#ifdef/#ifndef/#elif/#else/#endif 的嵌套，
+     把条件为 DEBUG（或 !NDEBUG）的分支区间写入 FYDebugRegions
+     */
+    class FYDebugConditionCallbacks : public PPCallbacks {
+    private:
+        struct ConditionalBlock {
+            SourceLocation branchBegin;
+            bool branchIsDebug;
+            bool elseIsDebug;
+        };
+        
+        Preprocessor &PP;
+        FYDebugRegions &regions;
+        vector<ConditionalBlock> stack;
+        
+        static FYDebugSense senseForMacroName(StringRef name){
+            if (name == "DEBUG")
+                return FYDebugSenseDebug;
+            if (name == "NDEBUG")
+                return FYDebugSenseRelease;
+            return FYDebugSenseNone;
+        }
+        
+        /**
+         对条件表达式做原始词法分析得到 DEBUG 含义，注释会被词法分析跳过，
+         避免 "#if DEBUG // not NDEBUG" 这类行尾注释影响判断
+         */
+        FYDebugSense senseForCondition(SourceRange conditionRange){
+            SourceManager &SM = PP.getSourceManager();
+            SourceLocation begin = conditionRange.getBegin();
+            if (begin.isInvalid() || !begin.isFileID())
+                return FYDebugSenseNone;
+            
+            std::pair<FileID, unsigned> decomposed = SM.getDecomposedLoc(begin);
+            bool invalid = false;
+            StringRef buffer = SM.getBufferData(decomposed.first, &invalid);
+            if (invalid)
+                return FYDebugSenseNone;
+            
+            Lexer rawLexer(SM.getLocForStartOfFile(decomposed.first), PP.getLangOpts(),
+                           buffer.begin(), buffer.begin() + decomposed.second, buffer.end());
+            FYDebugSense sense = FYDebugSenseNone;
+            bool negated = false;
+            Token token;
+            for (bool first = true; ; first = false)
+            {
+                rawLexer.LexFromRawLexer(token);
+                //条件只占指令所在的逻辑行，遇到下一行的记号即结束
+                if (token.is(tok::eof) || (!first && token.isAtStartOfLine()))
+                    break;
+                if (first && token.is(tok::exclaim))
+                    negated = true;
+                if (token.is(tok::raw_identifier))
+                {
+                    FYDebugSense tokenSense = senseForMacroName(token.getRawIdentifier());
+                    //NDEBUG 优先于 DEBUG
+                    if (tokenSense == FYDebugSenseRelease || (tokenSense == FYDebugSenseDebug && sense == FYDebugSenseNone))
+                        sense = tokenSense;
+                }
+            }
+            
+            //只识别整体取反，复杂表达式按字面含义近似处理
+            if (sense != FYDebugSenseNone && negated)
+                sense = (sense == FYDebugSenseDebug) ? FYDebugSenseRelease : FYDebugSenseDebug;
+            return sense;
+        }
+        
+        void pushBlock(SourceLocation loc, FYDebugSense sense){
+            ConditionalBlock block;
+            block.branchBegin = loc;
+            block.branchIsDebug = sense == FYDebugSenseDebug;
+            block.elseIsDebug = sense == FYDebugSenseRelease;
+            stack.push_back(block);
+        }
+        
+        void closeBranch(SourceLocation loc){
+            if (!stack.empty() && stack.back().branchIsDebug)
+                regions.addRange(stack.back().branchBegin, loc);
+        }
+        
+    public:
+        FYDebugConditionCallbacks(Preprocessor &PP, FYDebugRegions &regions)
+        :PP(PP),regions(regions) {}
+        
+        void If(SourceLocation Loc, SourceRange ConditionRange, ConditionValueKind ConditionValue) override {
+            pushBlock(Loc, senseForCondition(ConditionRange));
+        }
+        
+        void Ifdef(SourceLocation Loc, const Token &MacroNameTok, const MacroDefinition &MD) override {
+            pushBlock(Loc, senseForMacroName(MacroNameTok.getIdentifierInfo()->getName()));
+        }
+        
+        void Ifndef(SourceLocation Loc, const Token &MacroNameTok, const MacroDefinition &MD) override {
+            FYDebugSense sense = senseForMacroName(MacroNameTok.getIdentifierInfo()->getName());
+            if (sense == FYDebugSenseDebug)
+                sense = FYDebugSenseRelease;
+            else if (sense == FYDebugSenseRelease)
+                sense = FYDebugSenseDebug;
+            pushBlock(Loc, sense);
+        }
+        
+        void Elif(SourceLocation Loc, SourceRange ConditionRange, ConditionValueKind ConditionValue, SourceLocation IfLoc) override {
+            closeBranch(Loc);
+            if (stack.empty())
+                return;
+            FYDebugSense sense = senseForCondition(ConditionRange);
+            stack.back().branchBegin = Loc;
+            stack.back().branchIsDebug = sense == FYDebugSenseDebug;
+            stack.back().elseIsDebug = false;
+        }
+        
+        void Else(SourceLocation Loc, SourceLocation IfLoc) override {
+            closeBranch(Loc);
+            if (stack.empty())
+                return;
+            stack.back().branchBegin = Loc;
+            stack.back().branchIsDebug = stack.back().elseIsDebug;
+            stack.back().elseIsDebug = false;
+        }
+        
+        void Endif(SourceLocation Loc, SourceLocation IfLoc) override {
+            closeBranch(Loc);
+            if (!stack.empty())
+                stack.pop_back();
+        }
+    };
+
     class FYPluginVisitor : public RecursiveASTVisitor<FYPluginVisitor>
     {
     private:
         CompilerInstance &Instance;
         ASTContext *Context;
+        const FYDebugRegions *debugRegions;
+        FYBaseline &baseline;
+        string logMacro;
+        string logMacroOpen;
+        
+        //语句所处的日志调用上下文
+        enum FYLogContext {
+            FYLogContextNone,
+            //位于需要报告的日志调用参数中
+            FYLogContextReported,
+            //位于 fy-allow-log 放行的日志调用参数中，不计入任何引用
+            FYLogContextAllowed
+        };
+        
+        //仅用于日志的 stringWithFormat: 变量及其引用统计
+        struct FormatVarUsage {
+            const VarDecl *varDecl;
+            const ObjCMessageExpr *formatExpr;
+            bool isHotPath;
+            unsigned logUses;
+            unsigned otherUses;
+        };
+        
+        //按声明顺序记录，保证告警顺序和基线指纹序号在多次编译间稳定；
+        //各方法复用同一块 arena 内存，编译单元结束时释放
+        FYArenaVector<FormatVarUsage> formatVars;
         
     public:
         /**重写VisitObjCXXXDecl访问
@@ -69,6 +253,7 @@ namespace  {
                 checkMethodNameForUppercaseName(declaration);
                 checkMethodParamsNameForUppercaseName(declaration);
                 checkMethodBodyForOver50Lines(declaration);
+                checkMethodBodyForReleaseLogging(declaration);
             }
 
             return true;
@@ -92,8 +277,8 @@ namespace  {
                 ObjCPropertyDecl::PropertyAttributeKind attrKind = propertyDecl->getPropertyAttributes();
                 string typeStr = propertyDecl->getType().getAsString();
                 
-                if (propertyDecl->getTypeSourceInfo() && isShouldUseCopy(typeStr) && !(attrKind & ObjCPropertyDecl::OBJC_PR_copy)) {
-                    cout<<"--------- "<<typeStr<<": 不是使用的 copy 修饰--------"<<endl;
+                if (propertyDecl->getTypeSourceInfo() && isShouldUseCopy(typeStr) && !(attrKind & ObjCPropertyDecl::OBJC_PR_copy) &&
+                    baseline.shouldReport("property-copy", propertyDecl, propertyDecl->getName())) {
                     DiagnosticsEngine &diag = Instance.getDiagnostics();
                     diag.Report(propertyDecl->getBeginLoc(), diag.getCustomDiagID(DiagnosticsEngine::Warning, "--------- %0 不是使用的 copy 修饰--------")) << typeStr;
                 }
@@ -115,7 +300,7 @@ namespace  {
             }
             //名称必须以小写字母开头
             char c = name[checkUppercaseNameIndex];
-            if (isUppercase(c))
+            if (isUppercase(c) && baseline.shouldReport("property-uppercase", decl, name))
             {
                 //修正提示
                 std::string tempName = name;
@@ -145,7 +330,7 @@ namespace  {
             
             //类名不能包含下划线
             size_t underscorePos = name.find('_', 1);
-            if (underscorePos != StringRef::npos)
+            if (underscorePos != StringRef::npos && baseline.shouldReport("property-underscore", decl, name))
             {
                 //修正提示
                 std::string tempName = name;
@@ -174,7 +359,7 @@ namespace  {
             {
                 ObjCPropertyDecl::PropertyAttributeKind attrKind = decl -> getPropertyAttributes();
                 
-                if(!(attrKind & ObjCPropertyDecl::OBJC_PR_weak))
+                if(!(attrKind & ObjCPropertyDecl::OBJC_PR_weak) && baseline.shouldReport("delegate-weak", decl, decl -> getName()))
                 {
                     diagWaringReport(decl -> getLocation(), "代理属性应该使用weak修饰", NULL);
                 }
@@ -192,7 +377,7 @@ namespace  {
             
             //类名称必须以大写字母开头
             char c = className[0];
-            if (isLowercase(c))
+            if (isLowercase(c) && baseline.shouldReport("class-lowercase", decl, className))
             {
                 //修正提示
                 std::string tempName = className;
@@ -215,7 +400,7 @@ namespace  {
             StringRef className = decl -> getName();
             //类名不能包含下划线
             size_t underscorePos = className.find('_');
-            if (underscorePos != StringRef::npos)
+            if (underscorePos != StringRef::npos && baseline.shouldReport("class-underscore", decl, className))
             {
                 //修正提示
                 std::string tempName = className;
@@ -244,7 +429,7 @@ namespace  {
             {
                 StringRef selName = sel.getNameForSlot(i);
                 char c = selName[0];
-                if (isUppercase(c))
+                if (isUppercase(c) && baseline.shouldReport("method-uppercase", decl, selName))
                 {
                     //修正提示
                     std::string tempName = selName;
@@ -269,7 +454,7 @@ namespace  {
                 ParmVarDecl *parmVarDecl = *it;
                 StringRef name = parmVarDecl -> getName();
                 char c = name[0];
-                if (isUppercase(c))
+                if (isUppercase(c) && baseline.shouldReport("param-uppercase", decl, name))
                 {
                     //修正提示
                     std::string tempName = name;
@@ -296,16 +481,312 @@ namespace  {
             //存在方法体
             Stmt *methodBody = decl -> getBody();
             
-            string srcCode;
-            srcCode.assign(Instance.getSourceManager().getCharacterData(methodBody->getSourceRange().getBegin()),
-                            methodBody->getSourceRange().getEnd().getRawEncoding() - methodBody->getSourceRange().getBegin().getRawEncoding() + 1);
-            vector<string> lines = split(srcCode, '\n');
-            if(lines.size() > 50)
+            //按展开位置的行号计算行数，方法体首尾位于宏展开中时也不会越界
+            SourceManager &SM = Instance.getSourceManager();
+            unsigned beginLine = SM.getExpansionLineNumber(methodBody->getBeginLoc());
+            unsigned endLine = SM.getExpansionLineNumber(methodBody->getEndLoc());
+            //首尾不在同一文件时行号可能倒序，避免无符号数下溢
+            unsigned lineCount = endLine >= beginLine ? endLine - beginLine + 1 : 0;
+            if(lineCount > 50 && baseline.shouldReport("method-lines", decl, decl -> getSelector().getAsString()))
             {
                 diagWaringReport(decl -> getSourceRange().getBegin(), "单个方法内行数不能超过50行", NULL);
             }
         }
     }
+        
+        /**
+         检测方法中未被 #if DEBUG 包裹的 NSLog/printf 调用，以及仅用于日志的 stringWithFormat:
+         
+         按是否位于循环内、是否为 UI/网络回调给出 高/中/低 三档，
+         方法上标注 __attribute__((annotate("fy_allow_log"))) 或调用所在行/上一行
+         含有 fy-allow-log 注释时不报告
+         
+         @param decl 方法声明
+         */
+        void checkMethodBodyForReleaseLogging(ObjCMethodDecl *decl){
+            if (!decl -> hasBody() || isLoggingAllowedForMethod(decl))
+                return;
+            
+            bool isUICallback = isUIOrNetworkCallback(decl -> getSelector());
+            formatVars.clear();
+            scanLoggingStmt(decl, decl -> getBody(), 0, isUICallback, FYLogContextNone, true);
+            
+            for (const FormatVarUsage &usage : formatVars)
+            {
+                if (usage.logUses == 0 || usage.otherUses > 0)
+                    continue;
+                SourceLocation location = usage.formatExpr -> getBeginLoc();
+                if (isLoggingSuppressedAt(location) || !baseline.shouldReport("release-logging-format", decl, usage.varDecl -> getName()))
+                    continue;
+                DiagnosticsEngine &diagEngine = Instance.getDiagnostics();
+                unsigned DiagID = diagEngine.getCustomDiagID(DiagnosticsEngine::Warning, "[%0] 该 stringWithFormat: 只用于日志，Release 下仍会格式化，请移入 %1 包裹的日志调用中");
+                diagEngine.Report(location, DiagID) << loggingRank(usage.isHotPath, isUICallback) << logMacro;
+            }
+        }
+        
+        /**
+         递归遍历语句，记录循环深度并检测日志调用
+         
+         @param method 所在方法
+         @param stmt 当前语句
+         @param loopDepth 所在循环层数，enumerate 系列方法的 block 也按循环计
+         @param isUICallback 所在方法是否为 UI/网络回调
+         @param logContext 所处的日志调用上下文
+         @param resultUnused 语句的值是否被丢弃，只有这种调用才能安全地用日志宏包裹
+         */
+        void scanLoggingStmt(const ObjCMethodDecl *method, Stmt *stmt, unsigned loopDepth, bool isUICallback, FYLogContext logContext,
+                             bool resultUnused){
+            if (!stmt)
+                return;
+            
+            if (DeclStmt *declStmt = dyn_cast<DeclStmt>(stmt))
+            {
+                for (Decl *child : declStmt -> decls())
+                {
+                    VarDecl *varDecl = dyn_cast<VarDecl>(child);
+                    if (!varDecl || !varDecl -> hasInit())
+                        continue;
+                    const ObjCMessageExpr *formatExpr = dyn_cast<ObjCMessageExpr>(varDecl -> getInit() -> IgnoreParenImpCasts());
+                    if (formatExpr && isStringWithFormatMessage(formatExpr))
+                    {
+                        FormatVarUsage usage = {varDecl, formatExpr, loopDepth > 0, 0, 0};
+                        formatVars.push_back(usage);
+                    }
+                }
+            }
+            else if (DeclRefExpr *refExpr = dyn_cast<DeclRefExpr>(stmt))
+            {
+                const VarDecl *varDecl = dyn_cast<VarDecl>(refExpr -> getDecl());
+                //每个方法里的格式化变量很少，线性查找即可
+                for (FormatVarUsage &usage : formatVars)
+                {
+                    if (usage.varDecl != varDecl)
+                        continue;
+                    if (logContext == FYLogContextReported)
+                        usage.logUses++;
+                    else if (logContext == FYLogContextNone)
+                        usage.otherUses++;
+                    break;
+                }
+            }
+            else if (CallExpr *callExpr = dyn_cast<CallExpr>(stmt))
+            {
+                if (isLoggingCall(callExpr))
+                {
+                    if (isLoggingSuppressedAt(callExpr -> getBeginLoc()))
+                    {
+                        logContext = FYLogContextAllowed;
+                    }
+                    else
+                    {
+                        reportLoggingCall(method, callExpr, loopDepth > 0, isUICallback, resultUnused);
+                        logContext = FYLogContextReported;
+                    }
+                }
+            }
+            else if (isa<ForStmt>(stmt) || isa<WhileStmt>(stmt) || isa<DoStmt>(stmt) ||
+                     isa<ObjCForCollectionStmt>(stmt) || isa<CXXForRangeStmt>(stmt))
+            {
+                loopDepth++;
+            }
+            else if (ObjCMessageExpr *messageExpr = dyn_cast<ObjCMessageExpr>(stmt))
+            {
+                //enumerateObjectsUsingBlock: 等方法的 block 会被反复执行
+                if (messageExpr -> getSelector().getNameForSlot(0).startswith("enumerate"))
+                    loopDepth++;
+            }
+            else if (BlockExpr *blockExpr = dyn_cast<BlockExpr>(stmt))
+            {
+                //BlockExpr 的 children 不包含 block 体，需要单独进入
+                scanLoggingStmt(method, blockExpr -> getBody(), loopDepth, isUICallback, logContext, true);
+                return;
+            }
+            
+            for (Stmt *child : stmt -> children())
+            {
+                scanLoggingStmt(method, child, loopDepth, isUICallback, logContext,
+                                isResultDiscarded(stmt, child, resultUnused));
+            }
+        }
+        
+        /**
+         判断子语句的值是否被丢弃（作为独立语句出现），只有这种调用才能整体用日志宏包裹
+         
+         @param parent 父语句
+         @param child 子语句
+         @param parentResultUnused 父语句自身的值是否被丢弃
+         */
+        bool isResultDiscarded(Stmt *parent, Stmt *child, bool parentResultUnused){
+            if (isa<CompoundStmt>(parent))
+                return true;
+            if (IfStmt *ifStmt = dyn_cast<IfStmt>(parent))
+                return child == ifStmt -> getThen() || child == ifStmt -> getElse();
+            if (ForStmt *forStmt = dyn_cast<ForStmt>(parent))
+                return child == forStmt -> getBody();
+            if (WhileStmt *whileStmt = dyn_cast<WhileStmt>(parent))
+                return child == whileStmt -> getBody();
+            if (DoStmt *doStmt = dyn_cast<DoStmt>(parent))
+                return child == doStmt -> getBody();
+            if (ObjCForCollectionStmt *forInStmt = dyn_cast<ObjCForCollectionStmt>(parent))
+                return child == forInStmt -> getBody();
+            if (CXXForRangeStmt *rangeStmt = dyn_cast<CXXForRangeStmt>(parent))
+                return child == rangeStmt -> getBody();
+            if (SwitchCase *switchCase = dyn_cast<SwitchCase>(parent))
+                return child == switchCase -> getSubStmt();
+            if (LabelStmt *labelStmt = dyn_cast<LabelStmt>(parent))
+                return child == labelStmt -> getSubStmt();
+            //ExprWithCleanups 没有自己的源码，值是否被丢弃与父语句一致；
+            //(void)printf(...)、(printf(...)) 的括号和转换在调用之外，宏展开为空后会剩下 (void); 或 ();，不算丢弃
+            if (isa<ExprWithCleanups>(parent))
+                return parentResultUnused;
+            return false;
+        }
+        
+        /**
+         报告日志调用，并给出用日志宏包裹的修正提示
+         
+         @param method 所在方法
+         @param callExpr 日志调用
+         @param inLoop 是否位于循环内
+         @param isUICallback 所在方法是否为 UI/网络回调
+         @param resultUnused 返回值是否被丢弃，被使用时宏展开为空会无法编译，不给修正提示
+         */
+        void reportLoggingCall(const ObjCMethodDecl *method, CallExpr *callExpr, bool inLoop, bool isUICallback, bool resultUnused){
+            SourceLocation callStart = callExpr -> getBeginLoc();
+            //宏展开出的调用交给宏自身的条件编译处理
+            if (callStart.isMacroID())
+                return;
+            
+            StringRef calleeName = callExpr -> getDirectCallee() -> getName();
+            if (!baseline.shouldReport("release-logging", method, calleeName))
+                return;
+            
+            DiagnosticsEngine &diagEngine = Instance.getDiagnostics();
+            unsigned DiagID = diagEngine.getCustomDiagID(DiagnosticsEngine::Warning, "[%0] %1 在 Release 下仍会同步格式化输出，请使用 %2 包裹");
+            DiagnosticBuilder builder = diagEngine.Report(callStart, DiagID);
+            builder << loggingRank(inLoop, isUICallback) << calleeName << logMacro;
+            
+            SourceLocation callEnd = Lexer::getLocForEndOfToken(callExpr -> getEndLoc(), 0, Instance.getSourceManager(), Instance.getLangOpts());
+            if (resultUnused && callEnd.isValid())
+            {
+                builder << FixItHint::CreateInsertion(callStart, logMacroOpen)
+                        << FixItHint::CreateInsertion(callEnd, ")");
+            }
+        }
+        
+        /**
+         判断调用是否为需要检测的日志调用（NSLog/printf 系列），且未被 DEBUG 条件编译包裹
+         
+         fprintf/vfprintf 只在输出到 stdout/stderr 时才算日志，写文件的调用不能被日志宏删掉
+         */
+        bool isLoggingCall(const CallExpr *callExpr){
+            const FunctionDecl *callee = callExpr -> getDirectCallee();
+            if (!callee || !callee -> getIdentifier())
+                return false;
+            
+            StringRef name = callee -> getName();
+            if (name == "fprintf" || name == "vfprintf")
+            {
+                if (callExpr -> getNumArgs() == 0 || !isStandardStream(callExpr -> getArg(0)))
+                    return false;
+            }
+            else if (name != "NSLog" && name != "NSLogv" &&
+                     name != "printf" && name != "vprintf")
+            {
+                return false;
+            }
+            
+            if (debugRegions && debugRegions -> contains(Instance.getSourceManager(), callExpr -> getBeginLoc()))
+                return false;
+            return true;
+        }
+        
+        //stdout/stderr 在 Darwin 上展开为 __stdoutp/__stderrp
+        bool isStandardStream(const Expr *stream){
+            const DeclRefExpr *refExpr = dyn_cast<DeclRefExpr>(stream -> IgnoreParenImpCasts());
+            if (!refExpr || !refExpr -> getDecl() -> getIdentifier())
+                return false;
+            StringRef name = refExpr -> getDecl() -> getName();
+            return name == "stdout" || name == "stderr" || name == "__stdoutp" || name == "__stderrp";
+        }
+        
+        bool isStringWithFormatMessage(const ObjCMessageExpr *messageExpr){
+            if (messageExpr -> getSelector().getAsString() != "stringWithFormat:")
+                return false;
+            const ObjCInterfaceDecl *receiver = messageExpr -> getReceiverInterface();
+            return receiver && receiver -> getName() == "NSString";
+        }
+        
+        /**
+         判断方法是否为滚动、布局、绘制或网络数据回调等高频调用的方法
+         */
+        bool isUIOrNetworkCallback(Selector sel){
+            static const char *const callbackPrefixes[] = {
+                "scrollView",
+                "tableView:cellForRowAtIndexPath:",
+                "tableView:heightForRowAtIndexPath:",
+                "tableView:willDisplayCell:",
+                "collectionView:cellForItemAtIndexPath:",
+                "collectionView:layout:sizeForItemAtIndexPath:",
+                "collectionView:willDisplayCell:",
+                "layoutSubviews",
+                "drawRect:",
+                "viewWillLayoutSubviews",
+                "viewDidLayoutSubviews",
+                "touchesMoved:",
+                "observeValueForKeyPath:",
+                "URLSession:",
+                "connection:",
+            };
+            string selName = sel.getAsString();
+            for (const char *prefix : callbackPrefixes)
+            {
+                if (StringRef(selName).startswith(prefix))
+                    return true;
+            }
+            return false;
+        }
+        
+        const char *loggingRank(bool inLoop, bool isUICallback){
+            if (inLoop && isUICallback)
+                return "高";
+            if (inLoop || isUICallback)
+                return "中";
+            return "低";
+        }
+        
+        bool isLoggingAllowedForMethod(const ObjCMethodDecl *decl){
+            for (const AnnotateAttr *attr : decl -> specific_attrs<AnnotateAttr>())
+            {
+                if (attr -> getAnnotation() == "fy_allow_log")
+                    return true;
+            }
+            return false;
+        }
+        
+        /**
+         调用所在行或上一行含有 fy-allow-log 注释时不报告
+         */
+        bool isLoggingSuppressedAt(SourceLocation loc){
+            SourceManager &SM = Instance.getSourceManager();
+            std::pair<FileID, unsigned> decomposed = SM.getDecomposedLoc(SM.getExpansionLoc(loc));
+            bool invalid = false;
+            StringRef buffer = SM.getBufferData(decomposed.first, &invalid);
+            if (invalid)
+                return false;
+            
+            size_t lineStart = buffer.rfind('\n', decomposed.second);
+            lineStart = (lineStart == StringRef::npos) ? 0 : lineStart + 1;
+            size_t prevLineStart = 0;
+            if (lineStart > 0)
+            {
+                prevLineStart = buffer.rfind('\n', lineStart - 1);
+                prevLineStart = (prevLineStart == StringRef::npos) ? 0 : prevLineStart + 1;
+            }
+            size_t lineEnd = buffer.find('\n', decomposed.second);
+            return buffer.slice(prevLineStart, lineEnd).find("fy-allow-log") != StringRef::npos;
+        }
+        
         /**
          判断是否为用户源码
          */
@@ -336,21 +817,39 @@ namespace  {
             unsigned DiagID = diagEngine.getCustomDiagID(clang::DiagnosticsEngine::Warning, FormatString);
             (Hint!=NULL) ? diagEngine.Report(Loc, DiagID) << *Hint : diagEngine.Report(Loc, DiagID);
         }
+        //arena reset 时调用，丢弃格式化变量表在 arena 上的缓冲区
+        void releaseScratch(){
+            formatVars.release();
+        }
         void setASTContext (ASTContext &context){
             this -> Context = &context;
         }
         
-         FYPluginVisitor (CompilerInstance &Instance)
-        :Instance(Instance),Context(&(Instance.getASTContext())) {}
+         FYPluginVisitor (CompilerInstance &Instance, const FYDebugRegions *debugRegions, FYScratchArena &arena, FYBaseline &baseline, const string &logMacro)
+        :Instance(Instance),Context(&(Instance.getASTContext())),debugRegions(debugRegions),baseline(baseline),logMacro(logMacro),logMacroOpen(logMacro + "("),formatVars(arena, "release-logging") {}
     };
     
     //用于读取AST的抽象基类
     class FYASTConsumer: public ASTConsumer {
     private:
-        FYPluginVisitor *visitor;
+        //成员按声明顺序构造，visitor 依赖前面的 debugRegions、arena 与 baseline，必须放在最后
+        CompilerInstance &Instance;
+        string fileName;
+        bool memReport;
+        FYDebugRegions debugRegions;
+        FYScratchArena arena;
+        FYBaseline baseline;
+        FYPluginVisitor visitor;
     public:
-         FYASTConsumer(CompilerInstance &Instance)
-        :visitor(new FYPluginVisitor(Instance)) {}
+         FYASTConsumer(CompilerInstance &Instance, StringRef fileName, const string &logMacro, bool memReport,
+                       const FYBaselineOptions &baselineOptions)
+        :Instance(Instance),fileName(fileName),memReport(memReport),baseline(arena, "FYPlugin"),visitor(Instance, &debugRegions, arena, baseline, logMacro) {
+            baseline.loadAndReport(Instance.getDiagnostics(), baselineOptions, Instance.getTarget().getTriple().str());
+
+            //解析前注册预处理回调，记录 #if DEBUG 分支
+            Preprocessor &PP = Instance.getPreprocessor();
+            PP.addPPCallbacks(unique_ptr<PPCallbacks> (new FYDebugConditionCallbacks(PP, debugRegions)));
+        }
         
         virtual bool HandleTopLevelDecl(DeclGroupRef DG) override
         {
@@ -359,23 +858,67 @@ namespace  {
         
         virtual void HandleTranslationUnit(ASTContext& context) override
         {
-            visitor->TraverseDecl(context.getTranslationUnitDecl());
+            visitor.TraverseDecl(context.getTranslationUnitDecl());
+            
+            baseline.saveAndReport(Instance.getDiagnostics(), fileName);
+            
+            if (memReport)
+            {
+                arena.noteHeapBytes("baseline", baseline.getHeapBytes());
+                arena.report(llvm::errs(), "FYPlugin", fileName);
+            }
+            //编译单元结束，释放本单元的临时内存，arena 上的数组一并丢弃
+            visitor.releaseScratch();
+            baseline.releaseScratch();
+            arena.reset();
         }
     
     };
     
     //AST的插件，同时也是访问ASTConsumer的入口
     class FYASTAction: public PluginASTAction {
+        private:
+        //日志修正提示使用的宏，可通过 -plugin-arg-FYPlugin log-macro=XXX 指定
+        string logMacro = "FY_DEBUG_LOG";
+        //-plugin-arg-FYPlugin -mem-report 时输出每个编译单元的内存统计
+        bool memReport = false;
+        //baseline=PATH、baseline-update、baseline-merge，见 FYBaselineOptions
+        FYBaselineOptions baselineOptions;
+        
         protected:
         /**重写CreateASTConsumer方法
          创建并返回给前端一个ASTConsumer
          */
         unique_ptr<ASTConsumer> CreateASTConsumer(CompilerInstance &Instance, StringRef iFile) {
-            return unique_ptr<FYASTConsumer> (new FYASTConsumer(Instance));
+            return unique_ptr<FYASTConsumer> (new FYASTConsumer(Instance, iFile, logMacro, memReport, baselineOptions));
         }
         //插件的入口函数
         bool ParseArgs(const CompilerInstance &Instance, const std::vector<std::string> &args) {
-            return true;
+            for (const string &arg : args)
+            {
+                StringRef argRef(arg);
+                if (argRef.startswith("log-macro="))
+                {
+                    StringRef macro = argRef.substr(strlen("log-macro="));
+                    if (macro.empty())
+                    {
+                        DiagnosticsEngine &diag = Instance.getDiagnostics();
+                        diag.Report(diag.getCustomDiagID(DiagnosticsEngine::Error, "log-macro 参数不能为空"));
+                        return false;
+                    }
+                    logMacro = macro;
+                }
+                else if (argRef == "-mem-report" || argRef == "mem-report")
+                {
+                    memReport = true;
+                }
+                else
+                {
+                    baselineOptions.consumeArg(argRef);
+                }
+            }
+            
+            return baselineOptions.validate(Instance.getDiagnostics());
         }
     };
 }
@@ -0,0 +1,555 @@
+//
+//  FYPluginSupport.h
+//
+//  FYPlugin 与 CodeCheckPlugin 共用的编译单元临时内存 arena 与基线文件实现，
+//  两个插件读写同一种基线文件格式，统一放在这里避免两份代码不同步
+//
+
+#ifndef FYPluginSupport_h
+#define FYPluginSupport_h
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "clang/AST/DeclObjC.h"
+#include "clang/Basic/CharInfo.h"
+#include "clang/Basic/Diagnostic.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+namespace FYPluginSupport {
+
+    /**
+     单个编译单元内的临时数据（日志规则的格式化变量表、基线记录的指纹等）统一从 llvm::BumpPtrAllocator 分配，
+     在编译单元结束时整体释放，并按规则统计分配次数与字节数供 -mem-report 输出
+     
+     修正提示的字符串会被 FixItHint 复制进自己的 std::string，不走 arena
+     */
+    class FYScratchArena {
+    private:
+        struct RuleStats {
+            unsigned allocations = 0;
+            size_t bytes = 0;
+            //规则持有的、不在 arena 中的堆内存（如 DenseMap），报告前由调用方登记
+            size_t heapBytes = 0;
+        };
+        
+        llvm::BumpPtrAllocator allocator;
+        //规则名均为字符串字面量，直接以 llvm::StringRef 作为键
+        std::map<llvm::StringRef, RuleStats> ruleStats;
+        
+    public:
+        /**
+         为指定规则分配 count 个未初始化的 T
+         
+         @param rule 发起分配的规则名
+         @param count 元素个数
+         */
+        template <typename T>
+        T *allocate(llvm::StringRef rule, size_t count){
+            RuleStats &stats = ruleStats[rule];
+            stats.allocations++;
+            stats.bytes += count * sizeof(T);
+            return allocator.Allocate<T>(count);
+        }
+        
+        void noteHeapBytes(llvm::StringRef rule, size_t bytes){
+            if (bytes)
+                ruleStats[rule].heapBytes = bytes;
+        }
+        
+        //输出本编译单元的 arena 峰值与各规则的分配情况，需在 reset 之前调用
+        void report(llvm::raw_ostream &OS, llvm::StringRef pluginName, llvm::StringRef fileName){
+            OS << pluginName << " mem-report: " << fileName << "\n";
+            OS << "  arena high-water: " << allocator.getBytesAllocated() << " bytes, slabs: "
+               << allocator.getTotalMemory() << " bytes\n";
+            for (const auto &entry : ruleStats)
+            {
+                OS << "  " << entry.first << ": " << entry.second.allocations << " allocations, "
+                   << entry.second.bytes << " bytes";
+                if (entry.second.heapBytes)
+                    OS << ", heap " << entry.second.heapBytes << " bytes";
+                OS << "\n";
+            }
+        }
+        
+        void reset(){
+            allocator.Reset();
+            ruleStats.clear();
+        }
+    };
+    
+    /**
+     在 FYScratchArena 上增长的数组，只用于可平凡复制的元素
+     
+     扩容时旧缓冲区留在 arena 中直到编译单元结束，clear 保留容量，
+     因此按方法复用同一个数组时峰值只取决于最大的一次。
+     arena reset 后保留的缓冲区可能被重新分配给别人，必须在 reset 的同时调用 release
+     */
+    template <typename T>
+    class FYArenaVector {
+        static_assert(std::is_trivially_copyable<T>::value, "FYArenaVector 只支持可平凡复制的元素");
+        
+    private:
+        FYScratchArena &arena;
+        llvm::StringRef rule;
+        T *elements = nullptr;
+        size_t count = 0;
+        size_t capacity = 0;
+        
+    public:
+        FYArenaVector(FYScratchArena &arena, llvm::StringRef rule)
+        :arena(arena), rule(rule) {}
+        FYArenaVector(const FYArenaVector &) = delete;
+        FYArenaVector &operator=(const FYArenaVector &) = delete;
+        
+        void push_back(const T &value){
+            if (count == capacity)
+            {
+                size_t newCapacity = capacity ? capacity * 2 : 8;
+                T *newElements = arena.allocate<T>(rule, newCapacity);
+                std::copy(elements, elements + count, newElements);
+                elements = newElements;
+                capacity = newCapacity;
+            }
+            elements[count++] = value;
+        }
+        
+        //只清空元素，保留 arena 上的缓冲区供下次复用
+        void clear(){
+            count = 0;
+        }
+        
+        //丢弃 arena 上的缓冲区，与 FYScratchArena::reset 配套调用
+        void release(){
+            elements = nullptr;
+            count = capacity = 0;
+        }
+        
+        void truncate(size_t newCount){
+            count = std::min(count, newCount);
+        }
+        
+        T *begin() { return elements; }
+        T *end() { return elements + count; }
+        const T *begin() const { return elements; }
+        const T *end() const { return elements + count; }
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        
+        llvm::ArrayRef<T> asArrayRef() const {
+            return llvm::ArrayRef<T>(elements, count);
+        }
+    };
+    
+    /**
+     基线相关的插件参数，两个插件共用：
+     baseline=PATH    编译时丢弃 PATH 中已记录的问题
+     baseline-update  不报告问题，把本编译单元的全部指纹写入 PATH.d/ 下对应的分片，覆盖旧分片
+     baseline-merge   用 PATH.d/ 下全部分片的并集重新生成 PATH，源文件已不存在的分片会被删除
+     
+     重新生成基线：带 baseline-update 完整编译一次，再执行一次带 baseline-merge 的编译
+     （例如 clang -fsyntax-only -x objective-c /dev/null ...）。已修复问题的指纹会随分片被覆盖而消失
+     
+     分片按 (插件名, 目标三元组, 源文件绝对路径) 区分，FYPlugin 与 CodeCheckPlugin 可以共用同一个 PATH，
+     同一源文件按不同架构编译也各自保留分片，合并时取并集；
+     同一插件、同一架构下同一源文件编译多次（如不同的 -D 参数）仍会互相覆盖，以最后一次为准
+     */
+    struct FYBaselineOptions {
+        std::string path;
+        bool update = false;
+        bool merge = false;
+        
+        //识别基线参数，返回 false 表示不是基线参数
+        bool consumeArg(llvm::StringRef arg){
+            if (arg.startswith("baseline="))
+                path = arg.substr(strlen("baseline="));
+            else if (arg == "baseline-update")
+                update = true;
+            else if (arg == "baseline-merge")
+                merge = true;
+            else
+                return false;
+            return true;
+        }
+        
+        bool isValid() const {
+            return path.empty() ? !update && !merge : true;
+        }
+        
+        //在插件 ParseArgs 结束时调用，参数组合无效时报告错误并返回 false
+        bool validate(clang::DiagnosticsEngine &diag) const {
+            if (isValid())
+                return true;
+            diag.Report(diag.getCustomDiagID(clang::DiagnosticsEngine::Error, "baseline-update/baseline-merge 需要同时指定 baseline=PATH"));
+            return false;
+        }
+    };
+    
+    /**
+     基线文件：记录遗留代码中已有问题的指纹，编译时 mmap 载入，命中的问题在生成修正提示和诊断之前直接丢弃
+     
+     指纹是对 规则名、所在声明的类 USR 标识、规范化名称（小写）以及该组合在本编译单元内的出现序号 求 xxHash64，不含行号，
+     文件格式为 4 字节魔数 "FYBL"、4 字节版本号、8 字节条目数，随后是升序排列的小端 uint64 指纹；
+     PATH.d/ 下的分片使用同样的格式，并在指纹之后附加对应源文件的绝对路径
+     
+     出现序号按源码顺序编号，所以基线实际记录的是同一组合的问题个数，而不是具体哪一处：
+     记录了 N 处时，该组合前 N 处被丢弃、其余报告。在已有问题之前新增一处时，
+     被报告的是原来最后一处，新增的那处反而被丢弃，告警位置只能作为参考
+     */
+    class FYBaseline {
+    private:
+        static const size_t HeaderSize = 16;
+        static const uint32_t FormatVersion = 1;
+        
+        //分片键的一部分，区分共用同一基线的不同插件与目标架构
+        std::string pluginName;
+        std::string targetTriple;
+        std::string path;
+        bool updating = false;
+        bool merging = false;
+        std::unique_ptr<llvm::MemoryBuffer> buffer;
+        const char *entries = nullptr;
+        uint64_t entryCount = 0;
+        //同一 (规则, USR, 名称) 组合在本编译单元内的出现次数，用于区分同一方法内的多处问题
+        llvm::DenseMap<uint64_t, unsigned> occurrences;
+        //更新模式下本编译单元记录的指纹，分配在编译单元的 arena 上
+        FYArenaVector<uint64_t> recorded;
+        
+        static std::string shardDirectory(llvm::StringRef baselinePath){
+            return (baselinePath + ".d").str();
+        }
+        
+        static bool parse(const llvm::MemoryBuffer &file, const char *&fileEntries, uint64_t &fileEntryCount){
+            llvm::StringRef data = file.getBuffer();
+            if (data.size() < HeaderSize || !data.startswith("FYBL") ||
+                llvm::support::endian::read32le(data.data() + 4) != FormatVersion)
+                return false;
+            
+            uint64_t count = llvm::support::endian::read64le(data.data() + 8);
+            if (count > (data.size() - HeaderSize) / sizeof(uint64_t))
+                return false;
+            fileEntries = data.data() + HeaderSize;
+            fileEntryCount = count;
+            return true;
+        }
+        
+        /**
+         生成声明的类 USR 标识，仅用于本插件的基线指纹（插件私有格式，不需要额外链接 clangIndex）
+         
+         写法仿照 clang 的 ObjC USR（如 c:objc(cs)Class(im)sel:），但并不与 clang 完全一致：
+         类扩展输出为 c:objc(cy)Class@ 而不是 (ext)，分类中声明的方法带分类前缀而不是类的 USR，
+         不能与 clang 生成的 USR 混用
+         */
+        static void printUSR(const clang::Decl *decl, llvm::raw_ostream &OS){
+            if (const clang::ObjCMethodDecl *method = llvm::dyn_cast<clang::ObjCMethodDecl>(decl))
+            {
+                printUSR(clang::Decl::castFromDeclContext(method -> getDeclContext()), OS);
+                OS << (method -> isInstanceMethod() ? "(im)" : "(cm)") << method -> getSelector().getAsString();
+            }
+            else if (const clang::ObjCPropertyDecl *property = llvm::dyn_cast<clang::ObjCPropertyDecl>(decl))
+            {
+                printUSR(clang::Decl::castFromDeclContext(property -> getDeclContext()), OS);
+                OS << "(py)" << property -> getName();
+            }
+            else if (const clang::ObjCCategoryDecl *category = llvm::dyn_cast<clang::ObjCCategoryDecl>(decl))
+            {
+                const clang::ObjCInterfaceDecl *classDecl = category -> getClassInterface();
+                OS << "c:objc(cy)" << (classDecl ? classDecl -> getName() : llvm::StringRef()) << "@" << category -> getName();
+            }
+            else if (const clang::ObjCCategoryImplDecl *categoryImpl = llvm::dyn_cast<clang::ObjCCategoryImplDecl>(decl))
+            {
+                const clang::ObjCInterfaceDecl *classDecl = categoryImpl -> getClassInterface();
+                OS << "c:objc(cy)" << (classDecl ? classDecl -> getName() : llvm::StringRef()) << "@" << categoryImpl -> getName();
+            }
+            else if (const clang::ObjCImplementationDecl *implementation = llvm::dyn_cast<clang::ObjCImplementationDecl>(decl))
+            {
+                OS << "c:objc(cs)" << implementation -> getName();
+            }
+            else if (const clang::ObjCInterfaceDecl *interfaceDecl = llvm::dyn_cast<clang::ObjCInterfaceDecl>(decl))
+            {
+                OS << "c:objc(cs)" << interfaceDecl -> getName();
+            }
+            else if (const clang::ObjCProtocolDecl *protocol = llvm::dyn_cast<clang::ObjCProtocolDecl>(decl))
+            {
+                OS << "c:objc(pl)" << protocol -> getName();
+            }
+            else if (const clang::NamedDecl *namedDecl = llvm::dyn_cast<clang::NamedDecl>(decl))
+            {
+                OS << "c:@" << namedDecl -> getQualifiedNameAsString();
+            }
+        }
+        
+        bool containsFingerprint(uint64_t fingerprint) const {
+            uint64_t low = 0;
+            uint64_t high = entryCount;
+            while (low < high)
+            {
+                uint64_t mid = low + (high - low) / 2;
+                uint64_t value = llvm::support::endian::read64le(entries + mid * sizeof(uint64_t));
+                if (value == fingerprint)
+                    return true;
+                if (value < fingerprint)
+                    low = mid + 1;
+                else
+                    high = mid;
+            }
+            return false;
+        }
+        
+        /**
+         把升序指纹写入临时文件后原子替换目标文件，读取方不会看到写了一半的文件
+         
+         @param target 目标文件
+         @param fingerprints 升序、去重后的指纹
+         @param trailer 附加在指纹之后的内容（分片中的源文件路径）
+         */
+        static bool writeAtomically(const std::string &target, llvm::ArrayRef<uint64_t> fingerprints,
+                                    llvm::StringRef trailer, std::string &error){
+            int fd;
+            llvm::SmallString<128> tempPath;
+            if (std::error_code ec = llvm::sys::fs::createUniqueFile(target + "-%%%%%%%%.tmp", fd, tempPath))
+            {
+                error = ec.message();
+                return false;
+            }
+            {
+                llvm::raw_fd_ostream OS(fd, true);
+                OS << "FYBL";
+                llvm::support::endian::write<uint32_t>(OS, FormatVersion, llvm::support::little);
+                llvm::support::endian::write<uint64_t>(OS, fingerprints.size(), llvm::support::little);
+                for (uint64_t fingerprint : fingerprints)
+                {
+                    llvm::support::endian::write<uint64_t>(OS, fingerprint, llvm::support::little);
+                }
+                OS << trailer;
+                OS.close();
+                if (OS.has_error())
+                {
+                    error = OS.error().message();
+                    OS.clear_error();
+                    llvm::sys::fs::remove(tempPath);
+                    return false;
+                }
+            }
+            if (std::error_code ec = llvm::sys::fs::rename(tempPath, target))
+            {
+                error = ec.message();
+                llvm::sys::fs::remove(tempPath);
+                return false;
+            }
+            return true;
+        }
+        
+        /**
+         写入本编译单元的分片，文件名由插件名、目标三元组和源文件绝对路径的哈希决定，
+         每个编译单元只写自己的分片，并行编译之间不需要加锁
+         
+         即使本单元没有问题也要写入空分片，覆盖掉上一次记录的旧指纹
+         */
+        bool writeShard(llvm::StringRef sourceFile, std::string &error){
+            llvm::SmallString<256> absolutePath(sourceFile);
+            llvm::sys::fs::make_absolute(absolutePath);
+            
+            std::string directory = shardDirectory(path);
+            if (std::error_code ec = llvm::sys::fs::create_directories(directory))
+            {
+                error = ec.message();
+                return false;
+            }
+            
+            std::sort(recorded.begin(), recorded.end());
+            recorded.truncate(std::unique(recorded.begin(), recorded.end()) - recorded.begin());
+            llvm::SmallString<512> shardKey;
+            shardKey += pluginName;
+            shardKey.push_back('\0');
+            shardKey += targetTriple;
+            shardKey.push_back('\0');
+            shardKey += absolutePath;
+            std::string shardPath = directory + "/" + llvm::utohexstr(llvm::xxHash64(shardKey)) + ".fybl";
+            return writeAtomically(shardPath, recorded.asArrayRef(), absolutePath, error);
+        }
+        
+        //用全部分片的并集重新生成基线文件，源文件已被删除的分片一并清理
+        bool mergeShards(std::string &error){
+            std::vector<uint64_t> merged;
+            std::error_code ec;
+            for (llvm::sys::fs::directory_iterator it(shardDirectory(path), ec), end; it != end && !ec; it.increment(ec))
+            {
+                llvm::StringRef shardPath = it -> path();
+                if (!shardPath.endswith(".fybl"))
+                    continue;
+                
+                llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> shard = llvm::MemoryBuffer::getFile(shardPath, -1, false);
+                const char *shardEntries = nullptr;
+                uint64_t shardEntryCount = 0;
+                if (!shard || !parse(**shard, shardEntries, shardEntryCount))
+                    continue;
+                
+                llvm::StringRef sourceFile = (*shard) -> getBuffer().substr(HeaderSize + shardEntryCount * sizeof(uint64_t));
+                if (!sourceFile.empty() && !llvm::sys::fs::exists(sourceFile))
+                {
+                    llvm::sys::fs::remove(shardPath);
+                    continue;
+                }
+                for (uint64_t i = 0; i < shardEntryCount; i++)
+                {
+                    merged.push_back(llvm::support::endian::read64le(shardEntries + i * sizeof(uint64_t)));
+                }
+            }
+            if (ec)
+            {
+                error = ec.message();
+                return false;
+            }
+            
+            std::sort(merged.begin(), merged.end());
+            merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+            return writeAtomically(path, merged, llvm::StringRef(), error);
+        }
+        
+    public:
+        FYBaseline(FYScratchArena &arena, llvm::StringRef pluginName)
+        :pluginName(pluginName), recorded(arena, "baseline") {}
+        
+        /**
+         载入基线文件，文件不存在时视为空基线
+         
+         @param options 基线参数
+         @param triple 本编译单元的目标三元组，用于区分分片
+         @return 文件存在但格式无效时返回 false
+         */
+        bool load(const FYBaselineOptions &options, llvm::StringRef triple){
+            targetTriple = triple;
+            path = options.path;
+            updating = options.update;
+            merging = options.merge;
+            if (path.empty())
+                return true;
+            //RequiresNullTerminator 为 false 时，较大的文件会直接 mmap
+            llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> file = llvm::MemoryBuffer::getFile(path, -1, false);
+            if (!file)
+                return true;
+            
+            buffer = std::move(*file);
+            if (!parse(*buffer, entries, entryCount))
+            {
+                buffer.reset();
+                entries = nullptr;
+                entryCount = 0;
+                return false;
+            }
+            return true;
+        }
+        
+        /**
+         载入基线文件，格式无效时报告警告并按空基线继续
+         
+         @param diag 本编译单元的诊断引擎
+         @param options 基线参数
+         @param triple 本编译单元的目标三元组
+         */
+        void loadAndReport(clang::DiagnosticsEngine &diag, const FYBaselineOptions &options, llvm::StringRef triple){
+            if (!load(options, triple))
+                diag.Report(diag.getCustomDiagID(clang::DiagnosticsEngine::Warning, "基线文件 %0 格式无效，已忽略")) << options.path;
+        }
+        
+        bool isEnabled() const {
+            return !path.empty();
+        }
+        
+        //arena reset 时调用，丢弃记录在 arena 上的指纹
+        void releaseScratch(){
+            recorded.release();
+        }
+        
+        //指纹序号表占用的堆内存，供 -mem-report 登记
+        size_t getHeapBytes() const {
+            return occurrences.getMemorySize();
+        }
+        
+        /**
+         基线中已有的问题直接跳过，在构造修正提示和调用 DiagnosticsEngine::Report 之前判断
+         
+         @param rule 规则名
+         @param decl 问题所在的声明
+         @param name 问题涉及的名称
+         */
+        bool shouldReport(llvm::StringRef rule, const clang::Decl *decl, llvm::StringRef name){
+            return !isEnabled() || !isBaselined(rule, decl, name);
+        }
+        
+        /**
+         判断问题是否已在基线中；更新模式下记录其指纹并返回 true，不再报告
+         
+         同一 (规则, USR, 名称) 按出现顺序编号，只能保证报告的数量正确，报告的位置可能是旧问题
+         
+         @param rule 规则名
+         @param decl 问题所在的声明
+         @param name 问题涉及的名称
+         */
+        bool isBaselined(llvm::StringRef rule, const clang::Decl *decl, llvm::StringRef name){
+            llvm::SmallString<256> key;
+            llvm::raw_svector_ostream OS(key);
+            OS << rule << '\0';
+            printUSR(decl, OS);
+            OS << '\0';
+            for (char c : name)
+            {
+                OS << clang::toLowercase(c);
+            }
+            uint64_t ordinal = occurrences[llvm::xxHash64(key)]++;
+            OS << '\0' << ordinal;
+            uint64_t fingerprint = llvm::xxHash64(key);
+            
+            if (updating)
+            {
+                recorded.push_back(fingerprint);
+                return true;
+            }
+            return containsFingerprint(fingerprint);
+        }
+        
+        /**
+         编译单元结束时调用：更新模式写入本单元的分片，合并模式重新生成基线文件
+         
+         @param sourceFile 本编译单元的源文件
+         */
+        bool save(llvm::StringRef sourceFile, std::string &error){
+            if (updating && !writeShard(sourceFile, error))
+                return false;
+            if (merging)
+            {
+                //合并会替换基线文件，先释放当前的映射
+                buffer.reset();
+                entries = nullptr;
+                entryCount = 0;
+                return mergeShards(error);
+            }
+            return true;
+        }
+        
+        //编译单元结束时调用 save，写入失败时报告警告
+        void saveAndReport(clang::DiagnosticsEngine &diag, llvm::StringRef sourceFile){
+            std::string error;
+            if (!save(sourceFile, error))
+                diag.Report(diag.getCustomDiagID(clang::DiagnosticsEngine::Warning, "基线文件 %0 写入失败: %1")) << path << error;
+        }
+    };
+}
+
+#endif /* FYPluginSupport_h */